@@ -7,6 +7,8 @@
  *
  * 2014-01-14 Started
  * 2014-01-18 Added helper function for parsing GET passed by mod_apache
+ * 2026-10-19 pgaspc now uses pgasp_parse_args() and pgasp_arg() from the pgasp extension instead,
+ *            pgasp_parse_get is kept for functions compiled by earlier versions
  *
  */
 --
@@ -0,0 +1,15 @@
+/*
+ * PGASP extension 1.0 to 1.1: partials
+ *
+ * 2026-10-19 Started
+ *
+ */
+
+\echo Use "alter extension pgasp update to '1.1'" to load this file. \quit
+
+/* marker for mod_pgasp to replace with the output of p_name(key), key is hex-encoded in client encoding,
+   the nonce is set by mod_pgasp for each request, markers without it are left alone */
+create function pgasp_partial (p_name text, p_key text default '')
+returns text
+as $$ select '<!--pgasp-partial ' || coalesce(current_setting('pgasp.nonce', true), '') || ' ' || p_name || ' ' || encode(convert_to(coalesce(p_key, ''), pg_client_encoding()), 'hex') || '-->' $$
+language sql stable parallel safe;
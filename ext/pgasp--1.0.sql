@@ -0,0 +1,18 @@
+/*
+ * PGASP extension functions, see pgasp.c
+ *
+ * 2026-10-19 Started
+ *
+ */
+
+\echo Use "create extension pgasp" to load this file. \quit
+
+create function pgasp_parse_args (p_get text)
+returns jsonb
+as 'MODULE_PATHNAME', 'pgasp_parse_args'
+language c immutable strict parallel safe;
+
+create function pgasp_arg (p_args jsonb, p_param text, p_default text default '')
+returns text
+as 'MODULE_PATHNAME', 'pgasp_arg'
+language c immutable strict parallel safe;
@@ -0,0 +1,153 @@
+/*
+ * pgasp.c - Postgres extension for PGASP (Adaptive Server Pages for Postgres)
+ * Author: "Alex Nedoboi" <my seven-letter surname at gmail>
+ *
+ * See pgasp.org for documentation
+ *
+ * Compilation: make -C ext (uses PGXS, needs postgresql-server-dev)
+ *
+ * Usage: create extension pgasp;
+ *
+ *    pgasp_parse_args('&a=1&b=x%20y&') returns '{"a": "1", "b": "x y"}'::jsonb
+ *    pgasp_arg(args, 'b', 'default') returns 'x y', or 'default' if b is missing or empty
+ *
+ * Functions created by pgaspc parse the GET string passed by mod_pgasp once per call with
+ * pgasp_parse_args(), then take each parameter with pgasp_arg() and let PL/pgSQL assignment
+ * convert it to the declared type.
+ *
+ * pgasp_partial(name, key) (SQL, since 1.1) returns the marker that mod_pgasp replaces with p_name(key)
+ *
+ * 2026-10-19 Started
+ * 2026-10-19 Version 1.1, added pgasp_partial()
+ *
+ */
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "mb/pg_wchar.h"
+#include "utils/builtins.h"
+#include "utils/jsonb.h"
+
+PG_MODULE_MAGIC;
+
+PG_FUNCTION_INFO_V1(pgasp_parse_args);
+PG_FUNCTION_INFO_V1(pgasp_arg);
+
+static int hex_value(char c)
+{
+   if (c >= '0' && c <= '9') return c - '0';
+   if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+   if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+   return -1;
+}
+
+/* decodes application/x-www-form-urlencoded src into dst, returns decoded length (never longer than len) */
+static int url_decode(const char * src, int len, char * dst)
+{
+   int i, n = 0, hi, lo;
+
+   for (i = 0; i < len; i++)
+   {
+      if (src[i] == '+')
+      {
+         dst[n++] = ' ';
+      }
+      else if (src[i] == '%' && i + 2 < len && (hi = hex_value(src[i+1])) >= 0 && (lo = hex_value(src[i+2])) >= 0)
+      {
+         dst[n++] = (char) (hi * 16 + lo);
+         i += 2;
+      }
+      else
+      {
+         dst[n++] = src[i];
+      }
+   }
+
+   return n;
+}
+
+/* pgasp_parse_args(text) returns jsonb: splits "&name=value&..." once, decodes names and values */
+Datum pgasp_parse_args(PG_FUNCTION_ARGS)
+{
+   text *            args = PG_GETARG_TEXT_PP(0);
+   char *            input = VARDATA_ANY(args);
+   int               input_length = VARSIZE_ANY_EXHDR(args);
+   char *            decoded = palloc(input_length + 1);
+   JsonbValue *      keys = palloc(sizeof(JsonbValue) * (input_length / 2 + 1));
+   JsonbValue *      values = palloc(sizeof(JsonbValue) * (input_length / 2 + 1));
+   JsonbParseState * state = NULL;
+   JsonbValue *      result;
+   int               pair_count = 0, n = 0, i = 0, start, equals, k;
+
+   while (i < input_length)
+   {
+      /* one pair is input[start .. i), name ends at equals */
+      start = i;
+      equals = -1;
+      while (i < input_length && input[i] != '&')
+      {
+         if (input[i] == '=' && equals < 0) equals = i;
+         i++;
+      }
+      if (equals < 0) equals = i;
+
+      if (equals > start)
+      {
+         keys[pair_count].type = jbvString;
+         keys[pair_count].val.string.val = decoded + n;
+         keys[pair_count].val.string.len = url_decode(input + start, equals - start, decoded + n);
+         n += keys[pair_count].val.string.len;
+
+         values[pair_count].type = jbvString;
+         values[pair_count].val.string.val = decoded + n;
+         values[pair_count].val.string.len = equals < i ? url_decode(input + equals + 1, i - equals - 1, decoded + n) : 0;
+         n += values[pair_count].val.string.len;
+
+         /* decoded bytes end up in text, so they must be valid in the database encoding (no %00 either),
+            an invalid pair is skipped rather than failing the page over a parameter it may not even use */
+         if (pg_verifymbstr(keys[pair_count].val.string.val, keys[pair_count].val.string.len, true)
+             && pg_verifymbstr(values[pair_count].val.string.val, values[pair_count].val.string.len, true))
+         {
+            pair_count++;
+         }
+         else
+         {
+            ereport(DEBUG1, (errmsg("pgasp_parse_args: skipping parameter not valid in database encoding")));
+            n = keys[pair_count].val.string.val - decoded;
+         }
+      }
+
+      i++; /* skipping & */
+   }
+
+   /* jsonb keeps the last of duplicate keys, pushing in reverse order so the first one wins like in pgasp_parse_get */
+   pushJsonbValue(&state, WJB_BEGIN_OBJECT, NULL);
+   for (k = pair_count - 1; k >= 0; k--)
+   {
+      pushJsonbValue(&state, WJB_KEY, &keys[k]);
+      pushJsonbValue(&state, WJB_VALUE, &values[k]);
+   }
+   result = pushJsonbValue(&state, WJB_END_OBJECT, NULL);
+
+   PG_RETURN_POINTER(JsonbValueToJsonb(result));
+}
+
+/* pgasp_arg(jsonb, name text, default text) returns text: value of name, or default if missing or empty */
+Datum pgasp_arg(PG_FUNCTION_ARGS)
+{
+   Jsonb *      args = PG_GETARG_JSONB_P(0);
+   text *       name = PG_GETARG_TEXT_PP(1);
+   JsonbValue   key;
+   JsonbValue * value;
+
+   key.type = jbvString;
+   key.val.string.val = VARDATA_ANY(name);
+   key.val.string.len = VARSIZE_ANY_EXHDR(name);
+
+   value = findJsonbValueFromContainer(&args->root, JB_FOBJECT, &key);
+
+   if (value == NULL || value->type != jbvString || value->val.string.len == 0)
+      PG_RETURN_TEXT_P(PG_GETARG_TEXT_PP(2));
+
+   PG_RETURN_TEXT_P(cstring_to_text_with_len(value->val.string.val, value->val.string.len));
+}
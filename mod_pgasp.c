@@ -13,6 +13,18 @@
  *    pgaspEnabled On
  *    pgaspConnectionString "host=... dbname=... user=... password=..."
  *
+ * Time spent in each phase (args, pool, db, partials, stream, in ms) is put into the pgasp-timing note,
+ * log it with %{pgasp-timing}n in LogFormat. pgaspServerTiming On also sends args, pool and db
+ * as Server-Timing header. pgaspRequestId On sets application_name and pgasp.request_id to
+ * UNIQUE_ID (mod_unique_id) while the function runs, so pg_stat_activity lines up with
+ * %{UNIQUE_ID}e in the log.
+ *
+ * Partials included with <+ name key +> come back from the function as <!--pgasp-partial nonce name hexkey-->
+ * markers. The nonce is random for every request and is set as pgasp.nonce while the function runs, only
+ * markers carrying it are replaced with the output of p_name(key), any other text is sent as is.
+ * pgaspPartialCacheTime (seconds, default 60, 0 = off) keeps rendered partials per pool key, name and key
+ * in each child process for that long, within one request each of them is rendered once anyway.
+ *
  * 2014-12-30 Started
  * 2015-01-02 Module is working, now onto Postgres connection
  * 2015-01-05 Postgres connection done
@@ -21,6 +33,10 @@
  * 2015-01-08 Added spit_pg_error()
  * 2015-01-09 Reading connection string from .conf now
  * 2015-01-17 Now passing GET to PL/pgSQL function as text parameter
+ * 2026-10-19 Sending bytea body as raw bytes with Content-Length
+ * 2026-10-19 Setting status and headers from the columns if function returns (headers, body)
+ * 2026-10-19 Added per-phase timing (pgasp-timing note, pgaspServerTiming) and pgaspRequestId
+ * 2026-10-19 Added partials: markers from pgasp_partial() are replaced with p_name(key), cached per key
  *
  * TODO: Pass POST to the PL/pgSQL function
  * TODO: Write helper PL/pgSQL functions to parse POST
@@ -43,14 +59,27 @@
 #include "apr_reslist.h"
 #include "apr_strings.h"
 #include "apr_escape.h"
+#include "apr_general.h"
+#include "apr_thread_mutex.h"
 #include "util_script.h"
 
 #define spit_pg_error(st) { ap_rprintf(r,"<!-- "); ap_rprintf(r,"Cannot %s: %s\n",st,PQerrorMessage(pgc)); ap_rprintf(r," -->\n"); }
 #define MAX_ALLOWED_PAGES 100
+#define MAX_PARTIAL_CACHE 1000 /* partials cached by a child process before the cache is dropped, keeps memory bounded */
+#define MAX_PARTIAL_CACHE_BYTES (4 * 1024 * 1024) /* and their total size, a larger partial is not cached */
+#define DEFAULT_PARTIAL_CACHE_TIME 60
+#define MAX_PARTIAL_DEPTH 8    /* partials including partials */
+#define PARTIAL_MARKER "<!--pgasp-partial "
+
+/* from catalog/pg_type_d.h, which is not part of the libpq client headers */
+#define BYTEAOID 17
 
 #define true 1
 #define false 0
 
+/* microseconds to milliseconds for timing output */
+#define MSEC(t) ((double) (t) / 1000.0)
+
 /* use __(xx) macro for debug logging */
 #define __(s, ...)  ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, __VA_ARGS__) ;
 
@@ -61,13 +90,14 @@
 
 #define clean_up_connection(s)			\
   PQclear(pgr),					\
-    pgasp_pool_close(s, pgc),			\
+    set_timing_note(r, &timing),		\
+    release_connection(s, pgc),			\
     OK;
 
 typedef enum
 {
   cmd_setkey, cmd_connection, cmd_allowed, cmd_enabled,
-  cmd_min, cmd_keep, cmd_max, cmd_exp
+  cmd_min, cmd_keep, cmd_max, cmd_exp, cmd_partial_cache
 }
 cmd_parts ;
 
@@ -86,6 +116,7 @@ typedef struct
   int nkeep, nkeep_set ;
   int nmax, nmax_set ;
   int exptime, exptime_set ;
+  int partial_cache_time, partial_cache_time_set ;
   int is_enabled, is_enabled_set;
   int allowed_count, allowed_count_set;
 }
@@ -96,6 +127,8 @@ typedef struct
   char *dir;
   const char *content_type;
   int content_type_set;
+  int server_timing, server_timing_set;
+  int request_id, request_id_set;
 }
 pgasp_dir_config;
 
@@ -104,23 +137,81 @@ typedef struct {
   char *args;
 } params_t;
 
+/* when each phase ended, 0 if not reached, and time spent rendering partials */
+typedef struct {
+  apr_time_t start, args, pool, db;
+  apr_time_t partials;
+} timing_t;
+
+typedef struct {
+  char *body;
+  apr_time_t expires;
+} partial_t;
+
+/* what rendering partials of one request needs */
+typedef struct {
+  request_rec *r;
+  PGconn *pgc;
+  const char **values; /* of the function call, key goes first */
+  int values_count;
+  const char *marker;   /* PARTIAL_MARKER nonce space */
+  apr_hash_t *rendered; /* partials of this request */
+  apr_time_t time;
+} splice_t;
+
 PGconn* pgasp_pool_open(server_rec* s);
 void pgasp_pool_close(server_rec* s, PGconn* sql);
 
 extern module AP_MODULE_DECLARE_DATA pgasp_module ;
 static apr_hash_t *pgasp_pool_config;
 
+/* rendered partials, per child process */
+static apr_pool_t *partial_cache_pool;
+static apr_hash_t *partial_cache;
+static int partial_cache_count;
+static apr_size_t partial_cache_bytes;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *partial_cache_mutex;
+#endif
+
 static int tab_args(void *data, const char *key, const char *value) {
   params_t *params = (params_t*) data;
+  /* pgasp_parse_args() decodes names as well as values */
+  const char *encoded_key = apr_pescape_urlencoded(params->r->pool, key);
   const char *encoded_value = apr_pescape_urlencoded(params->r->pool, value);
   if (params->args) {
-    params->args = apr_pstrcat(params->r->pool, params->args, "&", key, "=", apr_pescape_urlencoded(params->r->pool, value), NULL);
+    params->args = apr_pstrcat(params->r->pool, params->args, "&", encoded_key, "=", encoded_value, NULL);
   } else {
-    params->args = apr_pstrcat(params->r->pool, key, "=", apr_pescape_urlencoded(params->r->pool, value), NULL);
+    params->args = apr_pstrcat(params->r->pool, encoded_key, "=", encoded_value, NULL);
   }
   return TRUE;/* TRUE:continue iteration. FALSE:stop iteration */
 }
 
+/* column "Status" sets HTTP status, "Content-Type" sets content type, any other column is sent as a header */
+static void apply_header(request_rec *r, PGresult *pgr, int row, int field) {
+  const char *name = PQfname(pgr, field);
+  const char *value;
+  int status;
+
+  if (PQgetisnull(pgr, row, field) || PQgetlength(pgr, row, field) == 0) return; /* NULL or empty means not set */
+  value = apr_pstrdup(r->pool, PQgetvalue(pgr, row, field));
+
+  if (strpbrk(value, "\r\n")) {
+    ap_log_error(APLOG_MARK, APLOG_WARNING, 0, r->server, "mod_pgasp: ignoring header %s with a line break", name);
+    return;
+  }
+
+  if (!strcasecmp(name, "Status")) {
+    status = atoi(value);
+    if (status >= 100 && status < 600) r->status = status;
+    else ap_log_error(APLOG_MARK, APLOG_WARNING, 0, r->server, "mod_pgasp: ignoring invalid status %s", value);
+  } else if (!strcasecmp(name, "Content-Type")) {
+    ap_set_content_type(r, value);
+  } else {
+    apr_table_set(r->headers_out, name, value);
+  }
+}
+
 static const char* set_param(cmd_parms* cmd, void* cfg,
 	const char* val) {
   const char* p ;
@@ -152,6 +243,9 @@ static const char* set_param(cmd_parms* cmd, void* cfg,
   case cmd_exp: ISINT(val) ; pgasp->exptime = atoi(val) ;
     pgasp->exptime_set = 1;
     break ;
+  case cmd_partial_cache: ISINT(val) ; pgasp->partial_cache_time = atoi(val) ;
+    pgasp->partial_cache_time_set = 1;
+    break ;
   case cmd_enabled:
     if (!strcasecmp(val, "on")) pgasp->is_enabled = true;
     else pgasp->is_enabled = false;
@@ -168,6 +262,57 @@ static const char *set_content_type(cmd_parms * cmd, void *config, const char *c
   return NULL;
 }
 
+static const char *set_server_timing(cmd_parms * cmd, void *config, const char *val) {
+  pgasp_dir_config *conf = (pgasp_dir_config *) config;
+  conf->server_timing = !strcasecmp(val, "on");
+  conf->server_timing_set = 1;
+  return NULL;
+}
+
+static const char *set_request_id(cmd_parms * cmd, void *config, const char *val) {
+  pgasp_dir_config *conf = (pgasp_dir_config *) config;
+  conf->request_id = !strcasecmp(val, "on");
+  conf->request_id_set = 1;
+  return NULL;
+}
+
+/* UNIQUE_ID from mod_unique_id, or Apache's own log ID */
+static const char *request_id_of(request_rec *r) {
+  const char *request_id = apr_table_get(r->subprocess_env, "UNIQUE_ID");
+  return request_id ? request_id : r->log_id;
+}
+
+/* argument of f_ and p_ calls, with the nonce set on the way in as $2 (pgasp.nonce) and the request ID, if any,
+   as $3 (application_name) and $4 (pgasp.request_id): set_config(..., true) is undone when the statement ends,
+   so it costs no extra round trip and nothing is left on the pooled connection */
+static const char *call_arg(int with_request_id) {
+  if (!with_request_id) return "case when set_config('pgasp.nonce', $2, true) is not null then $1::varchar end";
+  return "case when set_config('pgasp.nonce', $2, true) is not null"
+    " and set_config('application_name', $3, true) is not null"
+    " and set_config('pgasp.request_id', $4, true) is not null then $1::varchar end";
+}
+
+/* results left after an error would be read by the next request */
+static void release_connection(server_rec *s, PGconn *pgc) {
+  PGresult *pgr;
+
+  while (NULL != (pgr = PQgetResult(pgc))) PQclear(pgr);
+  pgasp_pool_close(s, pgc);
+}
+
+/* puts phase durations into the pgasp-timing note, phases a failed request did not reach count as 0 */
+static void set_timing_note(request_rec *r, timing_t *t) {
+  apr_time_t now = apr_time_now();
+
+  if (!t->args) t->args = now;
+  if (!t->pool) t->pool = now;
+  if (!t->db) t->db = now;
+
+  apr_table_setn(r->notes, "pgasp-timing",
+		 apr_psprintf(r->pool, "args=%.3f pool=%.3f db=%.3f partials=%.3f stream=%.3f",
+			      MSEC(t->args - t->start), MSEC(t->pool - t->args), MSEC(t->db - t->pool),
+			      MSEC(t->partials), MSEC(now - t->db - t->partials)));
+}
 
 static const command_rec pgasp_directives[] =
 {
@@ -179,32 +324,179 @@ static const command_rec pgasp_directives[] =
    AP_INIT_TAKE1("pgaspPoolKeep",         set_param, (void*)cmd_keep,       RSRC_CONF, "Maximum number of sustained connections"),
    AP_INIT_TAKE1("pgaspPoolMax",          set_param, (void*)cmd_max,        RSRC_CONF, "Maximum number of connections"),
    AP_INIT_TAKE1("pgaspPoolExptime",      set_param, (void*)cmd_exp,        RSRC_CONF, "Keepalive time for idle connections") ,
+   AP_INIT_TAKE1("pgaspPartialCacheTime", set_param, (void*)cmd_partial_cache, RSRC_CONF, "Seconds to keep rendered partials"),
    AP_INIT_TAKE1("pgaspContentType",      set_content_type, NULL, OR_AUTHCFG, "Content-Type header to send"),
+   AP_INIT_TAKE1("pgaspServerTiming",     set_server_timing, NULL, OR_AUTHCFG, "Send Server-Timing header"),
+   AP_INIT_TAKE1("pgaspRequestId",        set_request_id, NULL, OR_AUTHCFG, "Pass request ID to Postgres as application_name"),
    { NULL }
 };
 
+static const char *render_partials(splice_t *sp, const char *body, int depth);
+
+static int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/* returns partial name(hex_key) from this request or the cache, or renders it with p_name(key) and caches it */
+static const char *render_partial(splice_t *sp, const char *name, const char *hex_key, int depth) {
+  request_rec *r = sp->r;
+  PGconn *pgc = sp->pgc;
+  pgasp_config* config = (pgasp_config*) ap_get_module_config(r->server->module_config, &pgasp_module ) ;
+  char cursor_string[512];
+  const char *cache_key, *values[4];
+  const char *body = NULL;
+  char *key;
+  partial_t *cached;
+  PGresult *pgr;
+  apr_time_t now = apr_time_now();
+  apr_size_t length;
+  int i, n, hi, lo;
+
+  /* the marker carries our nonce, so it comes from the page code, still checking what goes into SQL */
+  for (i = 0; name[i]; i++)
+    if (name[i] != '_' && !isalnum((unsigned char) name[i])) break;
+  n = strlen(hex_key);
+  if (name[i] || i == 0 || i > 63 || n % 2) {
+    ap_log_error(APLOG_MARK, APLOG_WARNING, 0, r->server, "mod_pgasp: ignoring malformed partial marker %s %s", name, hex_key);
+    return NULL;
+  }
+
+  key = apr_palloc(r->pool, n / 2 + 1);
+  for (i = 0; i < n; i += 2) {
+    hi = hex_value(hex_key[i]);
+    lo = hex_value(hex_key[i+1]);
+    if (hi < 0 || lo < 0 || hi + lo == 0) { /* not hex, or zero byte that text can not hold */
+      ap_log_error(APLOG_MARK, APLOG_WARNING, 0, r->server, "mod_pgasp: ignoring malformed partial key %s for %s", hex_key, name);
+      return NULL;
+    }
+    key[i/2] = (char) (hi * 16 + lo);
+  }
+  key[n/2] = 0;
+
+  cache_key = apr_pstrcat(r->pool, config->key ? config->key : "", " ", name, " ", hex_key, NULL);
+
+  body = apr_hash_get(sp->rendered, cache_key, APR_HASH_KEY_STRING);
+  if (body) return body;
+
+  if (config->partial_cache_time > 0 && partial_cache) {
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(partial_cache_mutex);
+#endif
+    cached = apr_hash_get(partial_cache, cache_key, APR_HASH_KEY_STRING);
+    /* copying out while locked, another thread may drop the whole cache */
+    if (cached && cached->expires > now) body = apr_pstrdup(r->pool, cached->body);
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(partial_cache_mutex);
+#endif
+    if (body) return body;
+  }
+
+  snprintf(cursor_string, sizeof(cursor_string), "select p_%s(%s)", name, call_arg(sp->values_count > 2));
+  memcpy(values, sp->values, sp->values_count * sizeof(char *));
+  values[0] = key;
+
+  pgr = PQexecParams(pgc, cursor_string, sp->values_count, NULL, values, NULL, NULL, 0);
+  sp->time += apr_time_now() - now;
+
+  if (PQresultStatus(pgr) != PGRES_TUPLES_OK || PQntuples(pgr) != 1 || PQnfields(pgr) != 1) {
+    body = apr_psprintf(r->pool, "<!-- Cannot render partial %s: %s -->", name, PQerrorMessage(pgc));
+    PQclear(pgr);
+    return body;
+  }
+
+  /* partials included by this partial are rendered now, while their markers still carry our nonce */
+  body = render_partials(sp, apr_pstrdup(r->pool, PQgetvalue(pgr, 0, 0)), depth + 1);
+  PQclear(pgr);
+
+  apr_hash_set(sp->rendered, cache_key, APR_HASH_KEY_STRING, body);
+  length = strlen(body);
+
+  if (config->partial_cache_time > 0 && partial_cache && length <= MAX_PARTIAL_CACHE_BYTES) {
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(partial_cache_mutex);
+#endif
+    if (partial_cache_count >= MAX_PARTIAL_CACHE || partial_cache_bytes + length > MAX_PARTIAL_CACHE_BYTES) {
+      apr_pool_clear(partial_cache_pool);
+      partial_cache = apr_hash_make(partial_cache_pool);
+      partial_cache_count = 0;
+      partial_cache_bytes = 0;
+    }
+    partial_cache_count++;
+    partial_cache_bytes += length;
+    cached = apr_palloc(partial_cache_pool, sizeof(partial_t));
+    cached->body = apr_pstrdup(partial_cache_pool, body);
+    cached->expires = now + apr_time_from_sec(config->partial_cache_time);
+    apr_hash_set(partial_cache, apr_pstrdup(partial_cache_pool, cache_key), APR_HASH_KEY_STRING, cached);
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(partial_cache_mutex);
+#endif
+  }
+
+  return body;
+}
+
+/* returns text body with markers carrying this request's nonce replaced by partials, any other text is left as is */
+static const char *render_partials(splice_t *sp, const char *body, int depth) {
+  apr_array_header_t *pieces = NULL;
+  const char *marker, *spec, *space, *end, *partial;
+
+  while (NULL != (marker = strstr(body, sp->marker)) && NULL != (end = strstr(marker, "-->"))) {
+    if (pieces == NULL) pieces = apr_array_make(sp->r->pool, 8, sizeof(const char *));
+    APR_ARRAY_PUSH(pieces, const char *) = apr_pstrndup(sp->r->pool, body, marker - body);
+
+    spec = marker + strlen(sp->marker);
+    space = memchr(spec, ' ', end - spec);
+    partial = NULL;
+
+    if (depth >= MAX_PARTIAL_DEPTH)
+      ap_log_error(APLOG_MARK, APLOG_WARNING, 0, sp->r->server, "mod_pgasp: partials nested deeper than %d", MAX_PARTIAL_DEPTH);
+    else if (space == NULL)
+      ap_log_error(APLOG_MARK, APLOG_WARNING, 0, sp->r->server, "mod_pgasp: ignoring partial marker without key");
+    else
+      partial = render_partial(sp, apr_pstrndup(sp->r->pool, spec, space - spec), apr_pstrndup(sp->r->pool, space + 1, end - space - 1), depth);
+
+    if (partial) APR_ARRAY_PUSH(pieces, const char *) = partial;
+    body = end + 3;
+  }
+
+  if (pieces == NULL) return body;
+
+  APR_ARRAY_PUSH(pieces, const char *) = body;
+  return apr_array_pstrcat(sp->r->pool, pieces, 0);
+}
+
 static int pgasp_handler (request_rec * r)
 {
-   char cursor_string[256];
+   char cursor_string[512];
    pgasp_config* config = (pgasp_config*) ap_get_module_config(r->server->module_config, &pgasp_module ) ;
    pgasp_dir_config* dir_config = (pgasp_dir_config*) ap_get_module_config(r->per_dir_config, &pgasp_module ) ;
    apr_table_t * GET = NULL, *GETargs = NULL;
    apr_array_header_t * POST;
    PGconn * pgc;
-   PGresult * pgr;
+   PGresult * pgr = NULL;
    int i, j, allowed_to_serve, filename_length = 0;
-   int field_count, tuple_count;
+   int field_count, tuple_count, body_field, body_is_bytea;
+   unsigned char * bytes;
+   size_t bytes_length;
+   apr_array_header_t * deferred = apr_array_make(r->pool, 1, sizeof(char *));
    char * requested_file;
    char *basename;
    params_t params;
+   timing_t timing = { 0 };
+   const char * request_id = NULL;
+
+   unsigned char nonce_bytes[16];
+   splice_t splice;
 
    /* PQexecParams doesn't seem to like zero-length strings, so we feed it a dummy */
    const char * dummy_get = "nothing";
-   const char * dummy_user = "nobody";
 
-   const char * cursor_values[2] = { r -> args ? apr_pstrdup(r->pool, r -> args) : dummy_get, r->user ? r->user : dummy_user };
-   int cursor_value_lengths[2] = { strlen(cursor_values[0]), strlen(cursor_values[1]) };
-   int cursor_value_formats[2] = { 0, 0 };
+   const char * cursor_values[4] = { r -> args ? apr_pstrdup(r->pool, r -> args) : dummy_get, dummy_get, dummy_get, dummy_get };
+   int cursor_value_lengths[4] = { strlen(cursor_values[0]), strlen(cursor_values[1]), strlen(cursor_values[2]), strlen(cursor_values[3]) };
+   int cursor_value_formats[4] = { 0, 0, 0, 0 };
 
    if (!r -> handler || strcmp (r -> handler, "pgasp-handler") ) return DECLINED;
    if (!r -> method || (strcmp (r -> method, "GET") && strcmp (r -> method, "POST")) ) return DECLINED;
@@ -254,6 +546,8 @@ static int pgasp_handler (request_rec * r)
      basename = apr_pstrndup(r->pool, requested_file, filename_length);
    }
 
+   timing.start = apr_time_now();
+
    ap_args_to_table(r, &GETargs);
    if (OK != ap_parse_form_data(r, NULL, &POST, -1, (~((apr_size_t)0)))) {
      __(r->server, " ** ap_parse_form_data is NOT OK");
@@ -285,6 +579,24 @@ static int pgasp_handler (request_rec * r)
    cursor_values[0] = params.args;
    cursor_value_lengths[0] = strlen(cursor_values[0]);
 
+   /* fresh for every request and never sent to the client, so data can not carry a valid partial marker */
+   if (APR_SUCCESS != apr_generate_random_bytes(nonce_bytes, sizeof(nonce_bytes))) {
+     ap_log_error(APLOG_MARK, APLOG_ERR, 0, r->server, "mod_pgasp: can not generate nonce");
+     set_timing_note(r, &timing);
+     return HTTP_INTERNAL_SERVER_ERROR;
+   }
+   cursor_values[1] = apr_pescape_hex(r->pool, nonce_bytes, sizeof(nonce_bytes), 0);
+   cursor_value_lengths[1] = strlen(cursor_values[1]);
+
+   if (dir_config->request_id && NULL != (request_id = request_id_of(r))) {
+     cursor_values[2] = apr_pstrcat(r->pool, "pgasp ", request_id, NULL);
+     cursor_values[3] = request_id;
+     cursor_value_lengths[2] = strlen(cursor_values[2]);
+     cursor_value_lengths[3] = strlen(cursor_values[3]);
+   }
+
+   timing.args = apr_time_now();
+
    /* set response content type according to configuration or to default value */
    ap_set_content_type(r, dir_config->content_type_set ? dir_config->content_type : "text/html");
 
@@ -295,18 +607,29 @@ static int pgasp_handler (request_rec * r)
    if (PQstatus(pgc) != CONNECTION_OK)
    {
       spit_pg_error ("connect");
+      set_timing_note(r, &timing);
       pgasp_pool_close(r->server, pgc);
       return OK;
    }
 
+   timing.pool = apr_time_now();
+
+   splice.r = r;
+   splice.pgc = pgc;
+   splice.values = cursor_values;
+   splice.values_count = request_id ? 4 : 2;
+   splice.marker = apr_pstrcat(r->pool, PARTIAL_MARKER, cursor_values[1], " ", NULL);
+   splice.rendered = apr_hash_make(r->pool);
+   splice.time = 0;
+
    /* removing extention (.pgasp or other) from file name, and adding "f_" for function name, i.e. foo.pgasp becomes psp_foo() */
    snprintf(cursor_string,
 	    sizeof(cursor_string),
-	    "select * from f_%s($1::varchar)",
-	    basename);
+	    "select * from f_%s(%s)",
+	    basename, call_arg(request_id != NULL));
 
-   /* passing GET as first (and only) parameter */
-   if (0 == PQsendQueryParams (pgc, cursor_string, 1, NULL, cursor_values, cursor_value_lengths, cursor_value_formats, 0)) {
+   /* passing GET as first parameter, then nonce, and request ID if there is one */
+   if (0 == PQsendQueryParams (pgc, cursor_string, splice.values_count, NULL, cursor_values, cursor_value_lengths, cursor_value_formats, 0)) {
       spit_pg_error ("sending async query with params");
       return clean_up_connection(r->server);
    }
@@ -322,19 +645,62 @@ static int pgasp_handler (request_rec * r)
        return clean_up_connection(r->server);
      }
 
-     /* the following counts and for-loop may seem excessive as it's just 1 row/1 field, but might need it in the future */
+     /* headers go out with the first body bytes, so Server-Timing can only cover what happened until now */
+     if (timing.db == 0) {
+       timing.db = apr_time_now();
+       if (dir_config->server_timing) {
+	 apr_table_set(r->headers_out, "Server-Timing",
+		       apr_psprintf(r->pool, "args;dur=%.3f, pool;dur=%.3f, db;dur=%.3f",
+				    MSEC(timing.args - timing.start), MSEC(timing.pool - timing.args), MSEC(timing.db - timing.pool)));
+       }
+     }
+
+     /* the following counts and for-loop may seem excessive as it's just 1 row, but might need it in the future */
 
      field_count = PQnfields(pgr);
      tuple_count = PQntuples(pgr);
 
+     /* the last field is the body, the fields before it (if any) describe the response */
+     body_field = field_count - 1;
+     body_is_bytea = (body_field >= 0 && PQftype(pgr, body_field) == BYTEAOID);
+
      for (i = 0; i < tuple_count; i++)
        {
-	 for (j = 0; j < field_count; j++) ap_rprintf(r, "%s", PQgetvalue(pgr, i, j));
-	 ap_rprintf(r, "\n");
+	 for (j = 0; j < body_field; j++) apply_header(r, pgr, i, j);
+
+	 /* partials need the connection, which is busy until all results are read, so text with
+	    markers (and everything after it, to keep the order) is written once the loop is over */
+	 if (!body_is_bytea && (deferred->nelts || strstr(PQgetvalue(pgr, i, body_field), splice.marker))) {
+	   APR_ARRAY_PUSH(deferred, char *) = apr_pstrmemdup(r->pool, PQgetvalue(pgr, i, body_field), PQgetlength(pgr, i, body_field));
+	   continue;
+	 }
+
+	 /* bytea comes in text format as hex, it goes out byte for byte, text body keeps its trailing new line */
+	 if (body_is_bytea) {
+	   bytes = PQunescapeBytea((unsigned char *) PQgetvalue(pgr, i, body_field), &bytes_length);
+	   if (bytes == NULL) {
+	     ap_log_error(APLOG_MARK, APLOG_ERR, 0, r->server, "mod_pgasp: can not decode bytea from f_%s", basename);
+	     continue;
+	   }
+	   ap_set_content_length(r, bytes_length);
+	   ap_rwrite(bytes, bytes_length, r);
+	   PQfreemem(bytes);
+	 } else {
+	   ap_rwrite(PQgetvalue(pgr, i, body_field), PQgetlength(pgr, i, body_field), r);
+	   ap_rprintf(r, "\n");
+	 }
        }
      PQclear (pgr);
    }
-   pgasp_pool_close(r->server, pgc);
+
+   for (i = 0; i < deferred->nelts; i++) {
+     ap_rputs(render_partials(&splice, APR_ARRAY_IDX(deferred, i, char *), 0), r);
+     ap_rprintf(r, "\n");
+   }
+   timing.partials = splice.time;
+
+   set_timing_note(r, &timing);
+   release_connection(r->server, pgc);
 
    return OK;
 }
@@ -452,6 +818,18 @@ static apr_status_t init_db_pool(apr_pool_t* p, apr_pool_t* plog, apr_pool_t* pt
 
 
 
+static void init_partial_cache(apr_pool_t* p, server_rec* s) {
+  apr_pool_create(&partial_cache_pool, p);
+  partial_cache = apr_hash_make(partial_cache_pool);
+  partial_cache_count = 0;
+  partial_cache_bytes = 0;
+#if APR_HAS_THREADS
+  apr_thread_mutex_create(&partial_cache_mutex, APR_THREAD_MUTEX_DEFAULT, p);
+#endif
+}
+
+
+
 static void* create_pgasp_config(apr_pool_t* p, server_rec* s) {
   pgasp_config* config = (pgasp_config*) apr_pcalloc(p, sizeof(pgasp_config)) ;
   config->is_enabled = true;
@@ -459,6 +837,7 @@ static void* create_pgasp_config(apr_pool_t* p, server_rec* s) {
   config->allowed_count = 0;
   config->nmax = 1;
   config->exptime = 3600000;
+  config->partial_cache_time = DEFAULT_PARTIAL_CACHE_TIME;
   config->pool = p;
   return config ;
 }
@@ -485,6 +864,8 @@ static void *merge_pgasp_config(apr_pool_t * p, void *basev, void *addv) {
     new->nmax_set = add->nmax_set || base->nmax_set;
     new->exptime = (add->exptime_set == 0) ? base->exptime : add->exptime;
     new->exptime_set = add->exptime_set || base->exptime_set;
+    new->partial_cache_time = (add->partial_cache_time_set == 0) ? base->partial_cache_time : add->partial_cache_time;
+    new->partial_cache_time_set = add->partial_cache_time_set || base->partial_cache_time_set;
     new->is_enabled = (add->is_enabled_set == 0) ? base->is_enabled : add->is_enabled;
     new->is_enabled_set = add->is_enabled_set || base->is_enabled_set;
 
@@ -499,6 +880,10 @@ static void* create_dir_config(apr_pool_t* p, char* x) {
   conf->dir = x;
   conf->content_type = NULL;
   conf->content_type_set = 0;
+  conf->server_timing = false;
+  conf->server_timing_set = 0;
+  conf->request_id = false;
+  conf->request_id_set = 0;
 
   return conf ;
 }
@@ -510,6 +895,10 @@ static void *merge_dir_config(apr_pool_t * p, void *basev, void *addv) {
 
     new->content_type = (add->content_type_set == 0) ? base->content_type : add->content_type;
     new->content_type_set = add->content_type_set || base->content_type_set;
+    new->server_timing = (add->server_timing_set == 0) ? base->server_timing : add->server_timing;
+    new->server_timing_set = add->server_timing_set || base->server_timing_set;
+    new->request_id = (add->request_id_set == 0) ? base->request_id : add->request_id;
+    new->request_id_set = add->request_id_set || base->request_id_set;
 
     return new;
 }
@@ -521,6 +910,7 @@ static void register_hooks (apr_pool_t * pool)
     static const char * const aszPre[]={ "http_core.c", "http_vhost.c", NULL };
     ap_hook_pre_config (init_db_pool, NULL, NULL, APR_HOOK_MIDDLE) ;
     ap_hook_post_config (setup_db_pool, aszPre, NULL, APR_HOOK_LAST) ;
+    ap_hook_child_init (init_partial_cache, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_handler (pgasp_handler, NULL, NULL, APR_HOOK_LAST);
 }
 
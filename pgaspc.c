@@ -19,35 +19,77 @@
  * 2015-01-14 Printing extra single quote if not in code/equals/declare
  * 2015-01-17 Now getting _pgasp_get_ from Apache mod_pgasp
  * 2015-01-18 Added in_params
+ * 2026-10-19 Added bytea output: "name bytea [content/type]" in the function name line
+ * 2026-10-19 Added @Header lines, function returns a (headers, body) record for mod_pgasp to send
+ * 2026-10-19 Parameters are taken with pgasp_parse_args() and pgasp_arg() from the pgasp extension (see ext/)
+ * 2026-10-19 Added partials: "name partial" compiles to stable p_name(key), include tag <+ name key +>
  *
  * TODO: PHP wrapper generation
- * TODO: different variables declaration section (for parsing GET/POST) when generated for use with mod_pgasp
  * TODO: Error handling
  *
- * TOTHINK: Return a record instead of just text, i.e. (mime, body) or maybe (headers, body)
- *          ("text/html", "<!DOCTYPE html><html> ... </html>")
- *          ("application/json", "{ ... }")
- *          ("image/svg+xml", "<svg version='1.1'> ... </svg>")
  * TOTHINK: Do we really need in_declare in_header in_params? Perhaps can be simplified?
  *
  */
 
 //#define _GNU_SOURCE
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define true 1
 #define false 0
 
 #define MAX_INPUT_CHARS 4090
+#define MAX_HEADERS 32
+#define MAX_PARAMS 256
 
 int       in_code = false, in_equals = false, in_comment = false, in_declare = false, in_header = true, in_params = false;
-int       tag_processed = false, is_first_line = true;
+int       tag_processed = false, is_first_line = true, is_partial = false;
 FILE *    f;
 char      line_input [MAX_INPUT_CHARS + 4];
 char *    line_trimmed;
-int       i, j;
+char      param_output [MAX_INPUT_CHARS * 2];
+char *    function_name;
+char *    body_type = "text";
+char *    content_type = NULL;
+char *    header_names [MAX_HEADERS];
+char *    header_values [MAX_HEADERS];
+char *    param_lines [MAX_PARAMS];
+int       header_count = 0, param_count = 0;
+int       i, j, k;
+
+/* headers and parameters are only known by the time we reach <! so the function signature is printed then */
+static void print_signature(void)
+{
+   int k;
+
+   /* partial gets its cache key instead of GET, mod_pgasp calls it with the key from the include tag */
+   if (is_partial)
+   {
+      printf("create or replace function p_%s (_pgasp_KEY_ varchar)\nreturns text as $$\ndeclare\n_pgasp_ text;\n", function_name);
+      for (k = 0; k < param_count; k++) printf("%s", param_lines[k]);
+      return;
+   }
+
+   printf("create or replace function f_%s (_pgasp_GET_ varchar", function_name);
+
+   /* with headers the function returns a (headers, body) record, mod_pgasp sends the headers and then the body */
+   if (header_count)
+   {
+      for (k = 0; k < header_count; k++) printf(", out \"%s\" varchar", header_names[k]);
+      printf(", out _pgasp_ %s)\nas $$\ndeclare\n", body_type);
+   }
+   else
+   {
+      printf(")\nreturns %s as $$\ndeclare\n_pgasp_ %s;\n", body_type, body_type);
+   }
+
+   /* GET string is parsed and decoded once, each parameter is then just a lookup */
+   if (param_count) printf("_pgasp_args_ jsonb := pgasp_parse_args(_pgasp_GET_);\n");
+   for (k = 0; k < param_count; k++) printf("%s", param_lines[k]);
+}
 
 int main(int argc, char * argv[])
 {
@@ -81,11 +123,57 @@ int main(int argc, char * argv[])
 
       if (is_first_line)
       {
-         printf("create or replace function f_%s (_pgasp_GET_ varchar", line_trimmed);
-         printf(")\nreturns text as $$\ndeclare\n_pgasp_ text;");
+         /* Input  : name [type [content/type]], e.g. "return_chart bytea image/png"
+            Parsed : name [i] type [j] content/type */
+
+         i = 0;
+         while (line_trimmed[i] && line_trimmed[i] != ' ' && line_trimmed[i] != '\t') i++;
+         if (line_trimmed[i]) { line_trimmed[i++] = 0; }
+         while (line_trimmed[i] == ' ' || line_trimmed[i] == '\t') i++;
+
+         if (line_trimmed[i])
+         {
+            body_type = line_trimmed + i;
+            while (line_trimmed[i] && line_trimmed[i] != ' ' && line_trimmed[i] != '\t') i++;
+            if (line_trimmed[i]) { line_trimmed[i++] = 0; }
+            while (line_trimmed[i] == ' ' || line_trimmed[i] == '\t') i++;
+            if (line_trimmed[i]) content_type = line_trimmed + i;
+         }
+
+         if (!strcmp(body_type, "partial"))
+         {
+            is_partial = true;
+            body_type = "text";
+         }
+
+         if (strcmp(body_type, "text") && strcmp(body_type, "bytea"))
+         {
+            fprintf(stderr, "Unknown output type %s, expected text, bytea or partial\n", body_type);
+            exit (EXIT_FAILURE);
+         }
+
+         if (is_partial && content_type)
+         {
+            fprintf(stderr, "Partial %s cannot have a content type\n", line_trimmed);
+            exit (EXIT_FAILURE);
+         }
+
+         /* all of these point into line_input, so keep copies before the next fgets */
+         function_name = strdup(line_trimmed);
+         body_type = strdup(body_type);
+
+         /* content type from the name line is just another header */
+         if (content_type)
+         {
+            header_names[header_count] = "Content-Type";
+            header_values[header_count] = malloc(strlen(content_type) + 3);
+            sprintf(header_values[header_count], "\'%s\'", content_type);
+            header_count++;
+         }
 
          is_first_line = false;
          in_params = true;
+         continue;
       }
       else
       {
@@ -96,18 +184,61 @@ int main(int argc, char * argv[])
             in_params = false;
             in_declare = true;
             line_trimmed += 2;
+
+            print_signature();
          }
 
          if (line_trimmed[0] == '!' && line_trimmed[1] == '>')
          {
             in_declare = false;
-            printf("begin\n_pgasp_ := \'");
+            printf("begin\n");
+            for (j = 0; j < header_count; j++)
+               if (header_values[j]) printf("\"%s\" := %s;\n", header_names[j], header_values[j]);
+            printf("_pgasp_ := \'");
             line_trimmed += 2;
          }
 
+         /* HTTP response header @Name [value], e.g. "@Cache-Control 'public, max-age=300'",
+            becomes OUT column "Name" set to value, the code can change it like any other variable */
+         if (in_params && line_trimmed[0] == '@')
+         {
+            if (is_partial)
+            {
+               fprintf(stderr, "Partial %s cannot have headers\n", function_name);
+               exit (EXIT_FAILURE);
+            }
+
+            if (header_count == MAX_HEADERS)
+            {
+               fprintf(stderr, "Too many headers, maximum is %d\n", MAX_HEADERS);
+               exit (EXIT_FAILURE);
+            }
+
+            i = 1;
+            while (line_trimmed[i] && line_trimmed[i] != ' ' && line_trimmed[i] != '\t') i++;
+            header_names[header_count] = strndup(line_trimmed + 1, i - 1);
+            while (line_trimmed[i] == ' ' || line_trimmed[i] == '\t') i++;
+            header_values[header_count] = line_trimmed[i] ? strdup(line_trimmed + i) : NULL;
+            header_count++;
+
+            continue;
+         }
+
          /* processing parameters in HTTP GET passed by mod_apache */
          if (in_params)
          {
+            if (is_partial && param_count == 1)
+            {
+               fprintf(stderr, "Partial %s can only have one parameter, its cache key\n", function_name);
+               exit (EXIT_FAILURE);
+            }
+
+            if (param_count == MAX_PARAMS)
+            {
+               fprintf(stderr, "Too many parameters, maximum is %d\n", MAX_PARAMS);
+               exit (EXIT_FAILURE);
+            }
+
             i = 0;
 
             /* finding first and second white spaces */
@@ -119,9 +250,13 @@ int main(int argc, char * argv[])
 
             /* Input  : parameter type default
                Parsed : parameter [j] type [i] default
-               Output : parameter type := pgasp_parse_get(_pgasp_GET_, 'parameter', 'default'); */
+               Output : parameter type := pgasp_arg(_pgasp_args_, 'parameter', 'default'); */
 
-            printf("%.*s:= pgasp_parse_get(_pgasp_GET_, \'%.*s\', \'%s\');\n", i, line_trimmed, j, line_trimmed, line_trimmed+i);
+            if (is_partial)
+               snprintf(param_output, sizeof(param_output), "%.*s:= coalesce(nullif(_pgasp_KEY_, \'\'), \'%s\');\n", i, line_trimmed, line_trimmed+i);
+            else
+               snprintf(param_output, sizeof(param_output), "%.*s:= pgasp_arg(_pgasp_args_, \'%.*s\', \'%s\');\n", i, line_trimmed, j, line_trimmed, line_trimmed+i);
+            param_lines[param_count++] = strdup(param_output);
 
             continue;
          }
@@ -191,6 +326,51 @@ int main(int argc, char * argv[])
                   tag_processed = true;
                }
 
+               /* include tag <+ name key +>, key is an optional PL/pgSQL expression, the tag must close on the same line */
+               if (line_trimmed[i] == '<' && line_trimmed[i+1] == '+')
+               {
+                  if (!strcmp(body_type, "bytea"))
+                  {
+                     fprintf(stderr, "Include tag <+ can not be used in a bytea page\n");
+                     exit (EXIT_FAILURE);
+                  }
+                  if (in_code || in_equals)
+                  {
+                     fprintf(stderr, "Include tag <+ can not be used inside code or print tags\n");
+                     exit (EXIT_FAILURE);
+                  }
+
+                  i += 2;
+                  while (line_trimmed[i] == ' ' || line_trimmed[i] == '\t') i++;
+
+                  j = i;
+                  while (line_trimmed[i] == '_' || isalnum((unsigned char) line_trimmed[i])) i++;
+                  if (i == j)
+                  {
+                     fprintf(stderr, "Partial name expected after <+\n");
+                     exit (EXIT_FAILURE);
+                  }
+
+                  k = i;
+                  while (line_trimmed[k] && !(line_trimmed[k] == '+' && line_trimmed[k+1] == '>')) k++;
+                  if (!line_trimmed[k])
+                  {
+                     fprintf(stderr, "Include tag <+ %.*s is not closed with +> on the same line\n", i - j, line_trimmed + j);
+                     exit (EXIT_FAILURE);
+                  }
+
+                  /* mod_pgasp replaces the marker returned by pgasp_partial() with the output of p_name(key) */
+                  printf("\' || pgasp_partial(\'%.*s\', ", i - j, line_trimmed + j);
+                  while (line_trimmed[i] == ' ' || line_trimmed[i] == '\t') i++;
+                  j = k;
+                  while (j > i && (line_trimmed[j-1] == ' ' || line_trimmed[j-1] == '\t')) j--;
+                  if (i < j) printf("(%.*s)::text) || \'", j - i, line_trimmed + i);
+                  else printf("\'\') || \'");
+
+                  i = k + 2;
+                  tag_processed = true;
+               }
+
             }
             while (tag_processed);
 
@@ -204,11 +384,12 @@ int main(int argc, char * argv[])
 
       } /* not first line */
 
-      printf("\n");
+      /* binary output takes no line breaks from the page source, only what the code puts into _pgasp_ */
+      if (in_code || in_equals || in_declare || strcmp(body_type, "bytea")) printf("\n");
 
    } /* while fgets */
 
-   printf("\';\nreturn _pgasp_;\nend;\n$$\nlanguage plpgsql;\n\n\\q\n");
+   printf("\';\nreturn%s;\nend;\n$$\nlanguage plpgsql%s;\n\n\\q\n", header_count ? "" : " _pgasp_", is_partial ? " stable" : "");
 
    fclose (f);
    exit (EXIT_SUCCESS);